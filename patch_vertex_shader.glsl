@@ -0,0 +1,69 @@
+#version 330 core
+
+//    :   , (u, v)   gl_VertexID
+out vec3 fragNormal;
+out vec3 fragPos;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform vec3 controlPoints[16];
+uniform int tessellation;
+uniform bool stripOutput;
+
+//        ,      CPU
+const ivec2 quadCorners[6] = ivec2[6](
+    ivec2(0, 0), ivec2(0, 1), ivec2(1, 0),
+    ivec2(0, 1), ivec2(1, 1), ivec2(1, 0)
+);
+
+vec4 bernstein(float t)
+{
+    float s = 1.0 - t;
+    return vec4(s * s * s, 3.0 * t * s * s, 3.0 * t * t * s, t * t * t);
+}
+
+vec4 bernsteinDerivative(float t)
+{
+    float s = 1.0 - t;
+    return vec4(-3.0 * s * s, 3.0 * s * (s - 2.0 * t), 3.0 * t * (2.0 * s - t), 3.0 * t * t);
+}
+
+void main()
+{
+    // :     j,  (i, j), (i, j + 1); : 6   
+    ivec2 grid;
+    if (stripOutput) {
+        grid = ivec2(gl_VertexID / 2, gl_InstanceID + gl_VertexID % 2);
+    } else {
+        int quad = gl_VertexID / 6;
+        grid = ivec2(quad / tessellation, quad % tessellation) + quadCorners[gl_VertexID % 6];
+    }
+    vec2 uv = vec2(grid) / float(tessellation);
+
+    vec4 bu = bernstein(uv.x);
+    vec4 bv = bernstein(uv.y);
+    vec4 du = bernsteinDerivative(uv.x);
+    vec4 dv = bernsteinDerivative(uv.y);
+
+    vec3 position = vec3(0.0);
+    vec3 tangentU = vec3(0.0);
+    vec3 tangentV = vec3(0.0);
+    for (int i = 0; i < 4; i++) {
+        vec3 row = bv.x * controlPoints[i * 4] + bv.y * controlPoints[i * 4 + 1]
+            + bv.z * controlPoints[i * 4 + 2] + bv.w * controlPoints[i * 4 + 3];
+        vec3 rowDerivative = dv.x * controlPoints[i * 4] + dv.y * controlPoints[i * 4 + 1]
+            + dv.z * controlPoints[i * 4 + 2] + dv.w * controlPoints[i * 4 + 3];
+        position += bu[i] * row;
+        tangentU += du[i] * row;
+        tangentV += bu[i] * rowDerivative;
+    }
+
+    //   ,      CPU: cross(  v,   u)
+    vec3 normal = cross(tangentV, tangentU);
+
+    gl_Position = projection * view * model * vec4(position, 1.0);
+    fragNormal = mat3(transpose(inverse(model))) * normal;
+    fragPos = vec3(model * vec4(position, 1.0));
+}
\ No newline at end of file
@@ -9,6 +9,35 @@
 #include <cmath>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <cstdint>
+#include <string>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
 
 // --- : 16   ---
 glm::vec3 controlPoints[16] = {
@@ -20,8 +49,12 @@ glm::vec3 controlPoints[16] = {
 
 // ---   ---
 int tessellation = 10;
+const int MAX_TESSELLATION = 50;
 int selectedPoint = 0;
 bool needsUpdate = true; //    
+bool stripOutput = true; //       
+bool gpuEvaluation = false; //      16   uniform,    CPU   
+const GLuint PRIMITIVE_RESTART_INDEX = 0xFFFFFFFFu;
 
 // ---  ---
 glm::vec3 camPos = glm::vec3(3.0f, 5.0f, 15.0f);
@@ -32,27 +65,343 @@ float camPitch = 0.0f;
 float camSpeed = 0.5f;
 float camTurnSpeed = 2.0f;
 
-// --- ,     ---
-std::vector<glm::vec3> vertices;
-std::vector<glm::vec3> normals;
-std::vector<unsigned int> indices;
+// ---   :    ,           ---
+thread_local unsigned long long threadAllocations = 0;
+std::atomic<unsigned long long> simAllocations{ 0 }; //    ,    
+std::atomic<unsigned long long> simTicks{ 0 };
+
+//    new/delete. malloc  free      ,
+//     malloc  delete.  0 -   malloc.
+NOINLINE void* countedAllocate(std::size_t size, std::size_t alignment) {
+    threadAllocations++;
+    if (size == 0) size = 1;
+    if (alignment == 0) return malloc(size);
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    void* memory = nullptr;
+    return posix_memalign(&memory, std::max(alignment, sizeof(void*)), size) == 0 ? memory : nullptr;
+#endif
+}
+
+NOINLINE void countedFree(void* memory, std::size_t alignment) {
+#ifdef _WIN32
+    if (alignment != 0) {
+        _aligned_free(memory);
+        return;
+    }
+#else
+    (void)alignment;
+#endif
+    free(memory);
+}
+
+void* countedNew(std::size_t size, std::size_t alignment) {
+    if (void* memory = countedAllocate(size, alignment)) return memory;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size) { return countedNew(size, 0); }
+void* operator new[](std::size_t size) { return countedNew(size, 0); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return countedAllocate(size, 0); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return countedAllocate(size, 0); }
+
+void operator delete(void* memory) noexcept { countedFree(memory, 0); }
+void operator delete[](void* memory) noexcept { countedFree(memory, 0); }
+void operator delete(void* memory, std::size_t) noexcept { countedFree(memory, 0); }
+void operator delete[](void* memory, std::size_t) noexcept { countedFree(memory, 0); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { countedFree(memory, 0); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { countedFree(memory, 0); }
+
+#ifdef __cpp_aligned_new
+void* operator new(std::size_t size, std::align_val_t alignment) { return countedNew(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return countedNew(size, static_cast<std::size_t>(alignment)); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* memory, std::align_val_t alignment) noexcept { countedFree(memory, static_cast<std::size_t>(alignment)); }
+void operator delete[](void* memory, std::align_val_t alignment) noexcept { countedFree(memory, static_cast<std::size_t>(alignment)); }
+void operator delete(void* memory, std::size_t, std::align_val_t alignment) noexcept {
+    countedFree(memory, static_cast<std::size_t>(alignment));
+}
+void operator delete[](void* memory, std::size_t, std::align_val_t alignment) noexcept {
+    countedFree(memory, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    countedFree(memory, static_cast<std::size_t>(alignment));
+}
+void operator delete[](void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    countedFree(memory, static_cast<std::size_t>(alignment));
+}
+#endif
+
+// ---    :      ---
+//   ,       
+struct PatchArena {
+    unsigned char* base = nullptr;
+    size_t capacity = 0;
+    size_t offset = 0;
+
+    void reset(size_t bytes) {
+        if (bytes > capacity) {
+            ::operator delete(base);
+            base = static_cast<unsigned char*>(::operator new(bytes));
+            capacity = bytes;
+        }
+        offset = 0;
+    }
+
+    template <typename T>
+    T* allocate(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "    ");
+        size_t start = (offset + alignof(T) - 1) & ~(alignof(T) - 1);
+        offset = start + count * sizeof(T);
+        return reinterpret_cast<T*>(base + start);
+    }
+};
+
+// ---       ---
+template <typename T>
+struct Span {
+    T* data = nullptr;
+    size_t size = 0;
+
+    T& operator[](size_t i) const { return data[i]; }
+    T* begin() const { return data; }
+    T* end() const { return data + size; }
+};
+
+template <typename T>
+Span<T> arenaSpan(PatchArena& arena, size_t count) {
+    return { arena.allocate<T>(count), count };
+}
+
+// ---      (  ,   patchArena) ---
+//   GPU  :    ,  ,  ,  
+PatchArena patchArena;
+Span<glm::vec3> vertices;
+Span<glm::vec3> normals;
+unsigned long long geometryVersion = 1; //     ; 0 -   
+
+// ---     ---
+//    -      .      ,
+//      base vertex   ,    GPU ,    .
+//  ARB_buffer_storage   ;  GL 3.3        ,
+//      glMapBufferRange  :   ,  GPU   .
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+const unsigned STREAM_REGIONS = 3;
+const unsigned MAX_PENDING_FENCES = 4;
+const size_t MAX_PATCH_VERTICES = static_cast<size_t>((MAX_TESSELLATION + 1) * (MAX_TESSELLATION + 1));
+const size_t MAX_PATCH_INDICES = static_cast<size_t>(6 * MAX_TESSELLATION * MAX_TESSELLATION); //   
+
+struct StreamBuffer {
+    GLuint buffer = 0;
+    size_t regionBytes = 0;
+    unsigned char* memory = nullptr; //      
+
+    template <typename T>
+    T* region(unsigned index) const { return reinterpret_cast<T*>(memory + index * regionBytes); }
+};
+
+struct PatchStream {
+    bool persistent = false;
+    StreamBuffer positions, normals, indices;
+
+    // :           
+    unsigned long long regionVersion[STREAM_REGIONS] = {};
+    unsigned nextRegion = 0;
+
+    // : ,      ;   retiredVersion GPU   
+    GLsync fences[MAX_PENDING_FENCES] = {};
+    unsigned long long fenceVersions[MAX_PENDING_FENCES] = {};
+    unsigned fenceCount = 0;
+    std::atomic<unsigned long long> retiredVersion{ 1 };
+
+    //    retired,      ;    retireMutex
+    std::mutex retireMutex;
+    std::condition_variable retired;
+};
+
+PatchStream patchStream;
+unsigned patchRegion = 0;     //    
+size_t patchVertexCount = 0;
+size_t patchIndexCount = 0;
+
+// ---  : ,       ---
+struct SceneSnapshot {
+    glm::vec3 camPos, camFront, camUp;
+    glm::vec3 controlPoints[16];
+    int selectedPoint = 0;
+    unsigned long long geometryVersion = ~0ull;
+    bool stripOutput = false; //   ,    
+    bool gpuEvaluation = false;
+    int tessellation = 0;
+    unsigned geometryRegion = 0; //   patchStream    
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+};
+
+// --- Lock-free   ---
+//       ,   "".
+//   -   ,     .
+struct TripleBuffer {
+    static const unsigned FRESH = 4; // :     
+
+    SceneSnapshot slots[3];
+    std::atomic<unsigned> middle{ 1 };
+    unsigned writeIndex = 0;
+    unsigned readIndex = 2;
+
+    SceneSnapshot& back() { return slots[writeIndex]; }
+    const SceneSnapshot& front() const { return slots[readIndex]; }
+
+    //       
+    void publish() {
+        unsigned previous = middle.exchange(writeIndex | FRESH, std::memory_order_acq_rel);
+        writeIndex = previous & 3;
+    }
+
+    //    ,   
+    bool acquire() {
+        if (!(middle.load(std::memory_order_acquire) & FRESH)) return false;
+        unsigned previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = previous & 3;
+        return true;
+    }
+};
+
+// ---  ---
+const auto SIM_STEP = std::chrono::microseconds(16667); //     60 
+TripleBuffer sceneBuffer;
+std::atomic<bool> simRunning{ true };
+std::atomic<bool> keyState[GLFW_KEY_LAST + 1]; //   ,  
+
+// --- :  ,   ---
+//       ,   :       
+std::atomic<float> cursorNdcX{ 0.0f }, cursorNdcY{ 0.0f };
+std::atomic<int> windowHeight{ 800 };
+std::atomic<bool> mouseDown{ false };
+std::atomic<bool> mouseEvent{ false };
+std::mutex simWakeMutex;
+std::condition_variable simWake;
+
+// ---  ( ) ---
+const float POINT_SPRITE_SIZE = 15.0f;
+bool dragging = false;
+glm::vec3 dragPlaneNormal, dragOffset;
+float dragPlaneDistance = 0.0f;
+
+// ---   :      ---
+float basisTable[(MAX_TESSELLATION + 1) * 4];
+int basisTessellation = 0;
+
+// ---       ( ) ---
+//    ,    ,     
+//     ,  generatePatch       
+const int VERTEX_CACHE_SIZE = 32; //  LRU,    
+const int FIFO_CACHE_SIZE = 16;   //    ACMR/ATVR
+std::vector<unsigned int> listIndices;    //     
+std::vector<unsigned int> listVertexSlot; //    i * (tessellation + 1) + j  
+int listTessellation = 0;
 
 // --- OpenGL  ---
 GLuint patchVAO, patchVBO, patchNBO, patchEBO;
+GLuint gridVAO; //  VAO     : core-    VAO
 GLuint pointsVAO, pointsVBO, pointsColorVBO;
 GLuint axesVAO, axesVBO; //  
 
+// --- :       ---
+//     GL 4.1  ARB_get_program_binary,  GL 3.3   
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+const char* SHADER_DIR = "shaders";
+const char* SHADER_CACHE_DIR = "shader_cache";
+const uint32_t SHADER_CACHE_MAGIC = 0x48534742; // "BGSH"
+const uint64_t FNV_OFFSET_BASIS = 0xCBF29CE484222325ull;
+const size_t MAX_WATCHED_PROGRAMS = 4;
+
+struct ShaderCacheHeader {
+    uint32_t magic;
+    uint32_t binaryFormat;
+    uint64_t key;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+struct ShaderCache {
+    bool enabled = false;
+    GetProgramBinaryProc getProgramBinary = NULL;
+    ProgramBinaryProc programBinary = NULL;
+    ProgramParameteriProc programParameteri = NULL;
+    uint64_t driverHash = 0; //      ,   
+};
+
+struct ShaderProgram {
+    GLuint id = 0;
+    const char* vertexPath;
+    const char* fragmentPath;
+    uint64_t sourceHash = 0;
+    time_t vertexTime = 0, fragmentTime = 0; //    ,   inotify
+};
+
+struct ShaderWatcher {
+    int fd = -1; // inotify
+    double lastPoll = 0.0;
+};
+
+ShaderCache shaderCache;
+ShaderWatcher shaderWatcher;
+
 // ---   ---
 float B(int i, float t);
-glm::vec3 evaluateBezier(float u, float v);
+glm::vec3 evaluateBezier(const float* basisU, const float* basisV);
+glm::mat4 cameraView(const glm::vec3& pos, const glm::vec3& front, const glm::vec3& up);
+glm::mat4 cameraProjection();
 void generatePatch();
+void publishSnapshot();
+void simulationLoop();
+unsigned acquirePatchRegion();
 void setupPatchBuffers();
-void setupPointsBuffers();
+void switchPatchGeometry(const SceneSnapshot& scene);
+void retirePatchRegions();
+void setupPointsBuffers(const SceneSnapshot& scene);
 void setupAxesBuffers();
 void drawAxes(GLuint shaderProgram);
-void processInput(GLFWwindow* window);
+void drawGpuPatch(GLuint gridProgram, const SceneSnapshot& scene, const glm::mat4& view, const glm::mat4& proj, const glm::mat4& model);
+void updateStatsTitle(GLFWwindow* window);
+bool isKeyDown(int key);
+void processInput();
+void processMouse();
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void cursor_position_callback(GLFWwindow* window, double x, double y);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-GLuint createShaderProgram(const char* vertexPath, const char* fragmentPath);
+void initShaderCache();
+bool loadShaderProgram(ShaderProgram& program);
+void watchShaders();
+void reloadChangedShaders(ShaderProgram** programs, size_t count);
 
 // =================== Main ===================
 int main() {
@@ -65,6 +414,9 @@ int main() {
     if (!window) { glfwTerminate(); return -1; }
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetCursorPosCallback(window, cursor_position_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
         std::cout << "Failed to initialize GLAD\n"; return -1;
@@ -72,18 +424,49 @@ int main() {
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE); //    
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(PRIMITIVE_RESTART_INDEX);
     glPointSize(15.0f);
 
-    //  
-    generatePatch();
+    //  :      
     setupPatchBuffers();
-    setupPointsBuffers();
+    generatePatch();
+    publishSnapshot();
+    sceneBuffer.acquire();
+    unsigned long long uploadedVersion = sceneBuffer.front().geometryVersion;
+    switchPatchGeometry(sceneBuffer.front());
+    setupPointsBuffers(sceneBuffer.front());
     setupAxesBuffers();
 
-    GLuint shaderProgram = createShaderProgram("shaders/vertex_shader.glsl", "shaders/fragment_shader.glsl");
+    initShaderCache();
+    ShaderProgram shader;
+    shader.vertexPath = "shaders/vertex_shader.glsl";
+    shader.fragmentPath = "shaders/fragment_shader.glsl";
+    loadShaderProgram(shader);
+    ShaderProgram gridShader;
+    gridShader.vertexPath = "shaders/patch_vertex_shader.glsl";
+    gridShader.fragmentPath = "shaders/fragment_shader.glsl";
+    loadShaderProgram(gridShader);
+    ShaderProgram* programs[] = { &shader, &gridShader };
+    watchShaders();
+    glGenVertexArrays(1, &gridVAO);
+
+    // ,        ,    
+    std::thread simulationThread(simulationLoop);
 
     while (!glfwWindowShouldClose(window)) {
-        processInput(window);
+        glfwPollEvents();
+
+        sceneBuffer.acquire();
+        const SceneSnapshot& scene = sceneBuffer.front();
+        if (scene.geometryVersion != uploadedVersion) {
+            setupPointsBuffers(scene);
+            if (!scene.gpuEvaluation) switchPatchGeometry(scene);
+            uploadedVersion = scene.geometryVersion;
+        }
+        retirePatchRegions();
+        reloadChangedShaders(programs, 2);
+        GLuint shaderProgram = shader.id;
 
         glClearColor(0.1f, 0.1f, 0.15f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -91,8 +474,8 @@ int main() {
         glUseProgram(shaderProgram);
 
         // ---  ---
-        glm::mat4 view = glm::lookAt(camPos, camPos + camFront, camUp);
-        glm::mat4 proj = glm::perspective(glm::radians(45.0f), 1000.0f / 800.0f, 0.1f, 100.0f);
+        glm::mat4 view = cameraView(scene.camPos, scene.camFront, scene.camUp);
+        glm::mat4 proj = cameraProjection();
         glm::mat4 model = glm::mat4(1.0f);
 
         glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
@@ -100,18 +483,25 @@ int main() {
         glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(proj));
 
         // ---    ---
-        glUniform3fv(glGetUniformLocation(shaderProgram, "lightPos"), 1, glm::value_ptr(camPos));
+        glUniform3fv(glGetUniformLocation(shaderProgram, "lightPos"), 1, glm::value_ptr(scene.camPos));
         glUniform3f(glGetUniformLocation(shaderProgram, "lightColor"), 1.0f, 1.0f, 1.0f);
-        glUniform3fv(glGetUniformLocation(shaderProgram, "viewPos"), 1, glm::value_ptr(camPos));
+        glUniform3fv(glGetUniformLocation(shaderProgram, "viewPos"), 1, glm::value_ptr(scene.camPos));
 
         // ---   ---
-        glBindVertexArray(patchVAO);
-
-        //    ( )
-        glUniform1i(glGetUniformLocation(shaderProgram, "isBackFace"), 0);
-        glUniform3f(glGetUniformLocation(shaderProgram, "frontColor"), 0.8f, 0.5f, 0.3f);
-        glUniform3f(glGetUniformLocation(shaderProgram, "backColor"), 0.3f, 0.5f, 0.8f);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        if (scene.gpuEvaluation) {
+            drawGpuPatch(gridShader.id, scene, view, proj, model);
+            glUseProgram(shaderProgram);
+        }
+        else {
+            glBindVertexArray(patchVAO);
+
+            //    ( )
+            glUniform1i(glGetUniformLocation(shaderProgram, "isBackFace"), 0);
+            glUniform3f(glGetUniformLocation(shaderProgram, "frontColor"), 0.8f, 0.5f, 0.3f);
+            glUniform3f(glGetUniformLocation(shaderProgram, "backColor"), 0.3f, 0.5f, 0.8f);
+            glDrawElementsBaseVertex(scene.stripOutput ? GL_TRIANGLE_STRIP : GL_TRIANGLES, (GLsizei)scene.indexCount, GL_UNSIGNED_INT,
+                (void*)(scene.geometryRegion * patchStream.indices.regionBytes), (GLint)(scene.geometryRegion * MAX_PATCH_VERTICES));
+        }
 
         // ---    ---
         glBindVertexArray(pointsVAO);
@@ -121,20 +511,40 @@ int main() {
         // ---   ---
         drawAxes(shaderProgram);
 
+        updateStatsTitle(window);
         glfwSwapBuffers(window);
-        glfwPollEvents();
     }
 
+    {
+        std::lock_guard<std::mutex> lock(patchStream.retireMutex);
+        simRunning = false;
+    }
+    simWake.notify_one();
+    patchStream.retired.notify_one();
+    simulationThread.join();
+
     //  
+    for (unsigned i = 0; i < patchStream.fenceCount; i++) glDeleteSync(patchStream.fences[i]);
+    if (!patchStream.persistent) {
+        ::operator delete(patchStream.positions.memory);
+        ::operator delete(patchStream.normals.memory);
+        ::operator delete(patchStream.indices.memory);
+    }
     glDeleteVertexArrays(1, &patchVAO);
     glDeleteBuffers(1, &patchVBO);
     glDeleteBuffers(1, &patchNBO);
     glDeleteBuffers(1, &patchEBO);
+    glDeleteVertexArrays(1, &gridVAO);
     glDeleteVertexArrays(1, &pointsVAO);
     glDeleteBuffers(1, &pointsVBO);
     glDeleteBuffers(1, &pointsColorVBO);
     glDeleteVertexArrays(1, &axesVAO);
     glDeleteBuffers(1, &axesVBO);
+    glDeleteProgram(shader.id);
+    glDeleteProgram(gridShader.id);
+#ifdef __linux__
+    if (shaderWatcher.fd >= 0) close(shaderWatcher.fd);
+#endif
 
     glfwTerminate();
     return 0;
@@ -149,32 +559,235 @@ float B(int i, float t) {
     return C[i] * pow(t, i) * pow(1 - t, n - i);
 }
 
-// ---   ---
-glm::vec3 evaluateBezier(float u, float v) {
+// ---       ---
+glm::vec3 evaluateBezier(const float* basisU, const float* basisV) {
     glm::vec3 p(0, 0, 0);
-    for (int i = 0; i < 4; i++)
-        for (int j = 0; j < 4; j++)
-            p += B(i, u) * B(j, v) * controlPoints[i * 4 + j];
+    for (int i = 0; i < 4; i++) {
+        glm::vec3 row = basisV[0] * controlPoints[i * 4] + basisV[1] * controlPoints[i * 4 + 1]
+            + basisV[2] * controlPoints[i * 4 + 2] + basisV[3] * controlPoints[i * 4 + 3];
+        p += basisU[i] * row;
+    }
     return p;
 }
 
+// --- :             ---
+glm::mat4 cameraView(const glm::vec3& pos, const glm::vec3& front, const glm::vec3& up) {
+    return glm::lookAt(pos, pos + front, up);
+}
+
+glm::mat4 cameraProjection() {
+    return glm::perspective(glm::radians(45.0f), 1000.0f / 800.0f, 0.1f, 100.0f);
+}
+
+// ---     FIFO  16  ---
+struct VertexCacheStats {
+    float acmr; //   ,        0.5
+    float atvr; //   , 1.0 - 
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount) {
+    std::vector<unsigned int> fifo(FIFO_CACHE_SIZE, UINT32_MAX);
+    size_t head = 0, misses = 0;
+    for (unsigned int index : indices) {
+        if (std::find(fifo.begin(), fifo.end(), index) != fifo.end()) continue;
+        fifo[head] = index;
+        head = (head + 1) % fifo.size();
+        misses++;
+    }
+
+    size_t triangles = indices.size() / 3;
+    return { triangles ? static_cast<float>(misses) / static_cast<float>(triangles) : 0.0f,
+        vertexCount ? static_cast<float>(misses) / static_cast<float>(vertexCount) : 0.0f };
+}
+
+float forsythVertexScore(int cachePosition, int remainingTriangles) {
+    if (remainingTriangles == 0) return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        //      :  ,    
+        if (cachePosition < 3) {
+            score = 0.75f;
+        }
+        else {
+            float scale = 1.0f / static_cast<float>(VERTEX_CACHE_SIZE - 3);
+            score = powf(1.0f - static_cast<float>(cachePosition - 3) * scale, 1.5f);
+        }
+    }
+
+    //       ,   ,    
+    return score + 2.0f / sqrtf(static_cast<float>(remainingTriangles));
+}
+
+// ---      ---
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return;
+
+    //   ->    
+    std::vector<int> remaining(vertexCount, 0);
+    for (unsigned int index : indices) remaining[index]++;
+    std::vector<size_t> adjacencyStart(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) adjacencyStart[v + 1] = adjacencyStart[v] + static_cast<size_t>(remaining[v]);
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<size_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<unsigned char> emitted(triangleCount, 0);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    }
+
+    auto rescoreTriangles = [&](unsigned int v) {
+        for (size_t a = adjacencyStart[v]; a < adjacencyStart[v] + static_cast<size_t>(remaining[v]); ++a) {
+            unsigned int live = adjacency[a];
+            triangleScore[live] = vertexScore[indices[live * 3]] + vertexScore[indices[live * 3 + 1]] +
+                vertexScore[indices[live * 3 + 2]];
+        }
+    };
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve(VERTEX_CACHE_SIZE + 3);
+    nextCache.reserve(VERTEX_CACHE_SIZE + 3);
+    size_t scanPosition = 0;
+
+    for (size_t step = 0; step < triangleCount; ++step) {
+        //    ,   ;    -  
+        long long best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : cache) {
+            for (size_t a = adjacencyStart[v]; a < adjacencyStart[v + 1]; ++a) {
+                unsigned int t = adjacency[a];
+                if (!emitted[t] && triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+        if (best < 0) {
+            while (emitted[scanPosition]) scanPosition++;
+            best = static_cast<long long>(scanPosition);
+        }
+
+        size_t t = static_cast<size_t>(best);
+        emitted[t] = 1;
+        const unsigned int* corners = &indices[t * 3];
+        output.insert(output.end(), corners, corners + 3);
+
+        // LRU:      
+        nextCache.assign(corners, corners + 3);
+        for (unsigned int v : cache) {
+            if (v != corners[0] && v != corners[1] && v != corners[2]) nextCache.push_back(v);
+        }
+        for (int k = 0; k < 3; ++k) {
+            unsigned int v = corners[k];
+            remaining[v]--;
+            for (size_t a = adjacencyStart[v]; a < adjacencyStart[v + 1]; ++a) {
+                if (adjacency[a] == t) {
+                    std::swap(adjacency[a], adjacency[adjacencyStart[v] + static_cast<size_t>(remaining[v])]);
+                    break;
+                }
+            }
+        }
+
+        //   ,    ,  ,   
+        //  .   :      
+        for (size_t k = 0; k < nextCache.size(); ++k) {
+            unsigned int v = nextCache[k];
+            int position = k < static_cast<size_t>(VERTEX_CACHE_SIZE) ? static_cast<int>(k) : -1;
+            vertexScore[v] = forsythVertexScore(position, remaining[v]);
+        }
+        for (unsigned int v : nextCache) rescoreTriangles(v);
+        if (nextCache.size() > static_cast<size_t>(VERTEX_CACHE_SIZE)) nextCache.resize(VERTEX_CACHE_SIZE);
+        cache.swap(nextCache);
+    }
+
+    indices.swap(output);
+}
+
+// ---       ---
+//    ,       ,
+//       .    ,    
+void buildListOrder() {
+    size_t rowSize = static_cast<size_t>(tessellation + 1);
+    size_t vertexCount = rowSize * rowSize;
+    listIndices.clear();
+    listIndices.reserve(static_cast<size_t>(tessellation * tessellation) * 6);
+    for (int i = 0; i < tessellation; i++) {
+        for (int j = 0; j < tessellation; j++) {
+            unsigned int idx = static_cast<unsigned int>(i * rowSize + j);
+            unsigned int idxRight = idx + 1;
+            unsigned int idxDown = idx + static_cast<unsigned int>(rowSize);
+            unsigned int idxDiag = idxDown + 1;
+            unsigned int quad[6] = { idx, idxRight, idxDown, idxRight, idxDiag, idxDown };
+            listIndices.insert(listIndices.end(), quad, quad + 6);
+        }
+    }
+
+    VertexCacheStats before = analyzeVertexCache(listIndices, vertexCount);
+    optimizeVertexCache(listIndices, vertexCount);
+
+    listVertexSlot.assign(vertexCount, UINT32_MAX);
+    unsigned int nextSlot = 0;
+    for (unsigned int& index : listIndices) {
+        if (listVertexSlot[index] == UINT32_MAX) listVertexSlot[index] = nextSlot++;
+        index = listVertexSlot[index];
+    }
+    VertexCacheStats after = analyzeVertexCache(listIndices, vertexCount);
+    listTessellation = tessellation;
+
+    std::cout << "Vertex cache (tessellation " << tessellation << "): ACMR " << before.acmr << " -> " << after.acmr
+        << ", ATVR " << before.atvr << " -> " << after.atvr << "\n";
+}
+
 // ---       ---
+//     patchArena,         .
+//      buildListOrder,       listVertexSlot
 void generatePatch() {
-    vertices.clear();
-    normals.clear();
-    indices.clear();
+    size_t rowSize = static_cast<size_t>(tessellation + 1);
+    size_t vertexCount = rowSize * rowSize;
+    size_t quadCount = static_cast<size_t>(tessellation * tessellation);
+    size_t indexCount = stripOutput
+        ? static_cast<size_t>(tessellation) * rowSize * 2 + static_cast<size_t>(tessellation - 1)
+        : quadCount * 6;
+
+    patchArena.reset(vertexCount * 2 * sizeof(glm::vec3) + alignof(std::max_align_t));
+    vertices = arenaSpan<glm::vec3>(patchArena, vertexCount);
+    normals = arenaSpan<glm::vec3>(patchArena, vertexCount);
+
+    unsigned region = acquirePatchRegion();
+    glm::vec3* outPositions = patchStream.positions.region<glm::vec3>(region);
+    glm::vec3* outNormals = patchStream.normals.region<glm::vec3>(region);
+    unsigned int* indices = patchStream.indices.region<unsigned int>(region);
+    size_t index = 0;
+
+    //    u  v,  pow     ,   32   
+    if (basisTessellation != tessellation) {
+        for (int i = 0; i <= tessellation; i++)
+            for (int k = 0; k < 4; k++)
+                basisTable[i * 4 + k] = B(k, i / (float)tessellation);
+        basisTessellation = tessellation;
+    }
+
+    if (!stripOutput && listTessellation != tessellation) buildListOrder();
+    const unsigned int* slots = stripOutput ? nullptr : listVertexSlot.data();
 
     //  
     for (int i = 0; i <= tessellation; i++) {
-        float u = i / (float)tessellation;
         for (int j = 0; j <= tessellation; j++) {
-            float v = j / (float)tessellation;
-            vertices.push_back(evaluateBezier(u, v));
-            normals.push_back(glm::vec3(0.0f));
+            size_t k = i * rowSize + j;
+            vertices[k] = outPositions[slots ? slots[k] : k] = evaluateBezier(&basisTable[i * 4], &basisTable[j * 4]);
+            normals[k] = glm::vec3(0.0f);
         }
     }
 
-    //     
+    //  
     for (int i = 0; i < tessellation; i++) {
         for (int j = 0; j < tessellation; j++) {
             int idx = i * (tessellation + 1) + j;
@@ -182,16 +795,6 @@ void generatePatch() {
             int idxDown = idx + tessellation + 1;
             int idxDiag = idx + tessellation + 2;
 
-            //  
-            indices.push_back(idx);
-            indices.push_back(idxRight);
-            indices.push_back(idxDown);
-
-            //  
-            indices.push_back(idxRight);
-            indices.push_back(idxDiag);
-            indices.push_back(idxDown);
-
             //     
             glm::vec3 v1 = vertices[idxRight] - vertices[idx];
             glm::vec3 v2 = vertices[idxDown] - vertices[idx];
@@ -210,42 +813,213 @@ void generatePatch() {
     }
 
     //   
-    for (auto& n : normals) {
-        if (glm::length(n) > 0.0f) {
-            n = glm::normalize(n);
+    for (size_t k = 0; k < vertexCount; k++) {
+        glm::vec3 n = normals[k];
+        outNormals[slots ? slots[k] : k] = glm::length(n) > 0.0f ? glm::normalize(n) : n;
+    }
+
+    //  :   ,   -   (idx, right, down), (right, diag, down)
+    if (!stripOutput) {
+        std::copy(listIndices.begin(), listIndices.end(), indices);
+        index = listIndices.size();
+    }
+
+    // --- :    j,     ---
+    //  (i, j), (i, j + 1)    i        ,    ,
+    //  2     6
+    if (stripOutput) {
+        for (int j = 0; j < tessellation; j++) {
+            if (j > 0) indices[index++] = PRIMITIVE_RESTART_INDEX;
+            for (int i = 0; i <= tessellation; i++) {
+                int idx = i * (tessellation + 1) + j;
+                indices[index++] = idx;
+                indices[index++] = idx + 1;
+            }
         }
     }
+
+    patchRegion = region;
+    patchVertexCount = vertexCount;
+    patchIndexCount = indexCount;
+    patchStream.regionVersion[region] = geometryVersion;
 }
 
-// ---  VAO/VBO  ---
-void setupPatchBuffers() {
-    if (patchVAO == 0) {
-        glGenVertexArrays(1, &patchVAO);
-        glGenBuffers(1, &patchVBO);
-        glGenBuffers(1, &patchNBO);
-        glGenBuffers(1, &patchEBO);
+// ---      ( ) ---
+// ,       ;     - .
+//  GL   ,     ,      
+unsigned acquirePatchRegion() {
+    unsigned region = patchStream.nextRegion;
+    patchStream.nextRegion = (region + 1) % STREAM_REGIONS;
+    if (patchStream.regionVersion[region] >= patchStream.retiredVersion.load(std::memory_order_acquire)) {
+        std::unique_lock<std::mutex> lock(patchStream.retireMutex);
+        patchStream.retired.wait(lock, [region] {
+            return patchStream.regionVersion[region] < patchStream.retiredVersion.load(std::memory_order_acquire) || !simRunning;
+        });
+    }
+    return region;
+}
+
+// ---      ---
+void publishSnapshot() {
+    SceneSnapshot& scene = sceneBuffer.back();
+    scene.camPos = camPos;
+    scene.camFront = camFront;
+    scene.camUp = camUp;
+    std::copy(controlPoints, controlPoints + 16, scene.controlPoints);
+    scene.selectedPoint = selectedPoint;
+
+    //     ,      
+    scene.stripOutput = stripOutput;
+    scene.gpuEvaluation = gpuEvaluation;
+    scene.tessellation = tessellation;
+    scene.geometryRegion = patchRegion;
+    scene.vertexCount = patchVertexCount;
+    scene.indexCount = patchIndexCount;
+    scene.geometryVersion = geometryVersion;
+
+    sceneBuffer.publish();
+}
+
+// ---  : , ,   ---
+//        60 ,      
+void simulationLoop() {
+    auto nextTick = std::chrono::steady_clock::now();
+    while (simRunning) {
+        if (std::chrono::steady_clock::now() >= nextTick) {
+            processInput();
+            nextTick += SIM_STEP;
+        }
+        processMouse();
+
+        // ---     ---
+        //      :       
+        if (needsUpdate) {
+            geometryVersion++;
+            if (!gpuEvaluation) generatePatch();
+            needsUpdate = false;
+        }
+
+        publishSnapshot();
+        simAllocations.store(threadAllocations, std::memory_order_relaxed);
+        simTicks.fetch_add(1, std::memory_order_relaxed);
+
+        std::unique_lock<std::mutex> lock(simWakeMutex);
+        simWake.wait_until(lock, nextTick, [] { return mouseEvent.load() || !simRunning; });
+    }
+}
+
+// ---       ---
+void createStreamBuffer(StreamBuffer& stream, GLuint buffer, size_t regionBytes, BufferStorageProc bufferStorage) {
+    stream.buffer = buffer;
+    stream.regionBytes = regionBytes;
+    size_t totalBytes = regionBytes * STREAM_REGIONS;
+
+    // GL_COPY_WRITE_BUFFER    VAO
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    if (bufferStorage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        bufferStorage(GL_COPY_WRITE_BUFFER, totalBytes, NULL, flags);
+        stream.memory = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalBytes, flags));
     }
+    else {
+        glBufferData(GL_COPY_WRITE_BUFFER, totalBytes, NULL, GL_STREAM_DRAW);
+        stream.memory = static_cast<unsigned char*>(::operator new(totalBytes));
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+// ---  VAO/VBO :        ---
+void setupPatchBuffers() {
+    glGenVertexArrays(1, &patchVAO);
+    glGenBuffers(1, &patchVBO);
+    glGenBuffers(1, &patchNBO);
+    glGenBuffers(1, &patchEBO);
+
+    BufferStorageProc bufferStorage = NULL;
+    if (glfwExtensionSupported("GL_ARB_buffer_storage"))
+        bufferStorage = (BufferStorageProc)glfwGetProcAddress("glBufferStorage");
+    patchStream.persistent = bufferStorage != NULL;
+
+    createStreamBuffer(patchStream.positions, patchVBO, MAX_PATCH_VERTICES * sizeof(glm::vec3), bufferStorage);
+    createStreamBuffer(patchStream.normals, patchNBO, MAX_PATCH_VERTICES * sizeof(glm::vec3), bufferStorage);
+    createStreamBuffer(patchStream.indices, patchEBO, MAX_PATCH_INDICES * sizeof(unsigned int), bufferStorage);
+    std::cout << "Patch streaming: " << (patchStream.persistent ? "persistent mapped ring" : "unsynchronized map ring") << "\n";
 
     glBindVertexArray(patchVAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, patchVBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_DYNAMIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
     glEnableVertexAttribArray(0);
 
     glBindBuffer(GL_ARRAY_BUFFER, patchNBO);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), normals.data(), GL_DYNAMIC_DRAW);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
     glEnableVertexAttribArray(1);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, patchEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_DYNAMIC_DRAW);
 
     glBindVertexArray(0);
 }
 
+// ---       (   ) ---
+void uploadStreamRegion(const StreamBuffer& stream, unsigned region, size_t bytes) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, stream.buffer);
+    if (void* mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, region * stream.regionBytes, bytes, flags)) {
+        memcpy(mapped, stream.memory + region * stream.regionBytes, bytes);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+// ---       ---
+//       :   ,     
+void switchPatchGeometry(const SceneSnapshot& scene) {
+    if (!patchStream.persistent) {
+        uploadStreamRegion(patchStream.positions, scene.geometryRegion, scene.vertexCount * sizeof(glm::vec3));
+        uploadStreamRegion(patchStream.normals, scene.geometryRegion, scene.vertexCount * sizeof(glm::vec3));
+        uploadStreamRegion(patchStream.indices, scene.geometryRegion, scene.indexCount * sizeof(unsigned int));
+    }
+
+    //  :    ,     .        
+    //  ,    ,       
+    retirePatchRegions();
+    while (patchStream.fenceCount == MAX_PENDING_FENCES) {
+        GLenum status = glClientWaitSync(patchStream.fences[0], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        retirePatchRegions();
+        if (status == GL_WAIT_FAILED && patchStream.fenceCount == MAX_PENDING_FENCES) {
+            //  :    ,       
+            patchStream.fenceCount--;
+            glDeleteSync(patchStream.fences[patchStream.fenceCount]);
+        }
+    }
+
+    patchStream.fences[patchStream.fenceCount] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    patchStream.fenceVersions[patchStream.fenceCount] = scene.geometryVersion;
+    patchStream.fenceCount++;
+}
+
+// ---    :        ---
+void retirePatchRegions() {
+    while (patchStream.fenceCount > 0) {
+        GLenum status = glClientWaitSync(patchStream.fences[0], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+
+        glDeleteSync(patchStream.fences[0]);
+        {
+            std::lock_guard<std::mutex> lock(patchStream.retireMutex);
+            patchStream.retiredVersion.store(patchStream.fenceVersions[0], std::memory_order_release);
+        }
+        patchStream.retired.notify_one();
+        patchStream.fenceCount--;
+        for (unsigned i = 0; i < patchStream.fenceCount; i++) {
+            patchStream.fences[i] = patchStream.fences[i + 1];
+            patchStream.fenceVersions[i] = patchStream.fenceVersions[i + 1];
+        }
+    }
+}
+
 // ---  VAO/VBO   ---
-void setupPointsBuffers() {
+void setupPointsBuffers(const SceneSnapshot& scene) {
     if (pointsVAO == 0) {
         glGenVertexArrays(1, &pointsVAO);
         glGenBuffers(1, &pointsVBO);
@@ -254,12 +1028,12 @@ void setupPointsBuffers() {
 
     glm::vec3 pointColors[16];
     for (int i = 0; i < 16; i++)
-        pointColors[i] = (i == selectedPoint) ? glm::vec3(1.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 1.0f, 1.0f);
+        pointColors[i] = (i == scene.selectedPoint) ? glm::vec3(1.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 1.0f, 1.0f);
 
     glBindVertexArray(pointsVAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, pointsVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(controlPoints), controlPoints, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(scene.controlPoints), scene.controlPoints, GL_DYNAMIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
     glEnableVertexAttribArray(0);
 
@@ -310,21 +1084,182 @@ void drawAxes(GLuint shaderProgram) {
     glBindVertexArray(0);
 }
 
-// ---   ---
-void processInput(GLFWwindow* window) {
+// ---    : 16     -  ,    GPU ---
+//   :  - 6   ,  -    ,     
+void drawGpuPatch(GLuint gridProgram, const SceneSnapshot& scene, const glm::mat4& view, const glm::mat4& proj, const glm::mat4& model) {
+    glUseProgram(gridProgram);
+    glUniformMatrix4fv(glGetUniformLocation(gridProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix4fv(glGetUniformLocation(gridProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(gridProgram, "projection"), 1, GL_FALSE, glm::value_ptr(proj));
+    glUniform3fv(glGetUniformLocation(gridProgram, "lightPos"), 1, glm::value_ptr(scene.camPos));
+    glUniform3f(glGetUniformLocation(gridProgram, "lightColor"), 1.0f, 1.0f, 1.0f);
+    glUniform3fv(glGetUniformLocation(gridProgram, "viewPos"), 1, glm::value_ptr(scene.camPos));
+    glUniform1i(glGetUniformLocation(gridProgram, "isBackFace"), 0);
+    glUniform3f(glGetUniformLocation(gridProgram, "frontColor"), 0.8f, 0.5f, 0.3f);
+    glUniform3f(glGetUniformLocation(gridProgram, "backColor"), 0.3f, 0.5f, 0.8f);
+
+    glUniform3fv(glGetUniformLocation(gridProgram, "controlPoints"), 16, glm::value_ptr(scene.controlPoints[0]));
+    glUniform1i(glGetUniformLocation(gridProgram, "tessellation"), scene.tessellation);
+    glUniform1i(glGetUniformLocation(gridProgram, "stripOutput"), scene.stripOutput);
+
+    glBindVertexArray(gridVAO);
+    if (scene.stripOutput)
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 2 * (scene.tessellation + 1), scene.tessellation);
+    else
+        glDrawArrays(GL_TRIANGLES, 0, 6 * scene.tessellation * scene.tessellation);
+    glBindVertexArray(0);
+}
+
+// ---    : FPS,          ---
+void updateStatsTitle(GLFWwindow* window) {
+    static double lastUpdate = glfwGetTime();
+    static int frames = 0;
+    static unsigned long long renderAllocationsAtUpdate = threadAllocations;
+    static unsigned long long simAllocationsAtUpdate = 0, simTicksAtUpdate = 0;
+
+    frames++;
+    double now = glfwGetTime();
+    if (now - lastUpdate < 1.0) return;
+
+    unsigned long long simAllocationsNow = simAllocations.load(std::memory_order_relaxed);
+    unsigned long long simTicksNow = simTicks.load(std::memory_order_relaxed);
+    unsigned long long ticks = simTicksNow - simTicksAtUpdate;
+
+    //      ,      
+    char title[160];
+    snprintf(title, sizeof(title), "Bezier Patch | %d FPS | render %.1f allocs/frame | sim %.1f allocs/tick",
+        static_cast<int>(frames / (now - lastUpdate) + 0.5),
+        static_cast<double>(threadAllocations - renderAllocationsAtUpdate) / frames,
+        ticks ? static_cast<double>(simAllocationsNow - simAllocationsAtUpdate) / ticks : 0.0);
+    glfwSetWindowTitle(window, title);
+
+    lastUpdate = now;
+    frames = 0;
+    renderAllocationsAtUpdate = threadAllocations;
+    simAllocationsAtUpdate = simAllocationsNow;
+    simTicksAtUpdate = simTicksNow;
+}
+
+// ---  ,   ---
+bool isKeyDown(int key) {
+    return keyState[key].load(std::memory_order_relaxed);
+}
+
+// ---   ( ) ---
+void key_callback(GLFWwindow* window, int key, int, int action, int) {
+    if (key < 0 || key > GLFW_KEY_LAST) return;
+    keyState[key] = (action != GLFW_RELEASE);
+
     // ---  ---
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
+}
+
+// ---    :    ,     ---
+void signalMouseEvent() {
+    {
+        std::lock_guard<std::mutex> lock(simWakeMutex);
+        mouseEvent = true;
+    }
+    simWake.notify_one();
+}
+
+// ---   ( ):     NDC ---
+void cursor_position_callback(GLFWwindow* window, double x, double y) {
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    if (width <= 0 || height <= 0) return;
+
+    cursorNdcX = static_cast<float>(2.0 * x / width - 1.0);
+    cursorNdcY = static_cast<float>(1.0 - 2.0 * y / height);
+    windowHeight = height;
+    if (mouseDown) signalMouseEvent();
+}
+
+// ---    ( ) ---
+void mouse_button_callback(GLFWwindow*, int button, int action, int) {
+    if (button != GLFW_MOUSE_BUTTON_LEFT) return;
+    mouseDown = (action == GLFW_PRESS);
+    signalMouseEvent();
+}
+
+// ---      ---
+void cursorRay(glm::vec3& origin, glm::vec3& direction) {
+    glm::mat4 inverseViewProj = glm::inverse(cameraProjection() * cameraView(camPos, camFront, camUp));
+    glm::vec4 nearPoint = inverseViewProj * glm::vec4(cursorNdcX.load(), cursorNdcY.load(), -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProj * glm::vec4(cursorNdcX.load(), cursorNdcY.load(), 1.0f, 1.0f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+}
+
+// ---     ---
+//   -         ,   
+int pickControlPoint(const glm::vec3& origin, const glm::vec3& direction) {
+    float pixelsToWorld = 2.0f * std::tan(glm::radians(45.0f) * 0.5f) / std::max(windowHeight.load(), 1);
+    int picked = -1;
+    float nearest = 1e30f;
+    for (int i = 0; i < 16; i++) {
+        glm::vec3 toPoint = controlPoints[i] - origin;
+        float along = glm::dot(toPoint, direction);
+        if (along <= 0.0f) continue;
+
+        float radius = 0.5f * POINT_SPRITE_SIZE * pixelsToWorld * glm::dot(toPoint, camFront);
+        float missSquared = glm::dot(toPoint, toPoint) - along * along;
+        if (missSquared <= radius * radius && along < nearest) {
+            nearest = along;
+            picked = i;
+        }
+    }
+    return picked;
+}
+
+// ---   ( ) ---
+//    ,  ;      ,    
+void processMouse() {
+    if (!mouseEvent.exchange(false)) return;
+
+    glm::vec3 origin, direction;
+    cursorRay(origin, direction);
+
+    if (!mouseDown) {
+        dragging = false;
+        return;
+    }
+
+    if (!dragging) {
+        int picked = pickControlPoint(origin, direction);
+        if (picked < 0) return;
+
+        selectedPoint = picked;
+        dragPlaneNormal = camFront;
+        dragPlaneDistance = glm::dot(dragPlaneNormal, controlPoints[picked]);
+        float t = (dragPlaneDistance - glm::dot(dragPlaneNormal, origin)) / glm::dot(dragPlaneNormal, direction);
+        dragOffset = controlPoints[picked] - (origin + t * direction);
+        dragging = true;
+        needsUpdate = true;
+        return;
+    }
+
+    float facing = glm::dot(dragPlaneNormal, direction);
+    if (std::abs(facing) < 1e-4f) return;
+    float t = (dragPlaneDistance - glm::dot(dragPlaneNormal, origin)) / facing;
+    if (t <= 0.0f) return;
+
+    controlPoints[selectedPoint] = origin + t * direction + dragOffset;
+    needsUpdate = true;
+}
 
+// ---   ( ) ---
+void processInput() {
     // ---  ---
     float speed = camSpeed;
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) camPos += speed * camFront;
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) camPos -= speed * camFront;
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) camPos -= glm::normalize(glm::cross(camFront, camUp)) * speed;
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) camPos += glm::normalize(glm::cross(camFront, camUp)) * speed;
+    if (isKeyDown(GLFW_KEY_W)) camPos += speed * camFront;
+    if (isKeyDown(GLFW_KEY_S)) camPos -= speed * camFront;
+    if (isKeyDown(GLFW_KEY_A)) camPos -= glm::normalize(glm::cross(camFront, camUp)) * speed;
+    if (isKeyDown(GLFW_KEY_D)) camPos += glm::normalize(glm::cross(camFront, camUp)) * speed;
 
     // ---   ---
-    if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) {
+    if (isKeyDown(GLFW_KEY_R)) {
         camPos = glm::vec3(3.0f, 5.0f, 15.0f);
         camFront = glm::vec3(0.0f, 0.0f, -1.0f);
         camUp = glm::vec3(0.0f, 1.0f, 0.0f);
@@ -333,59 +1268,75 @@ void processInput(GLFWwindow* window) {
 
     // ---   ( /) ---
     static bool leftPressedLast = false, rightPressedLast = false;
-    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS && !leftPressedLast) {
+    if (isKeyDown(GLFW_KEY_LEFT) && !leftPressedLast) {
         selectedPoint = (selectedPoint + 15) % 16;
         needsUpdate = true;
         leftPressedLast = true;
     }
-    else if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_RELEASE) leftPressedLast = false;
+    else if (!isKeyDown(GLFW_KEY_LEFT)) leftPressedLast = false;
 
-    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS && !rightPressedLast) {
+    if (isKeyDown(GLFW_KEY_RIGHT) && !rightPressedLast) {
         selectedPoint = (selectedPoint + 1) % 16;
         needsUpdate = true;
         rightPressedLast = true;
     }
-    else if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_RELEASE) rightPressedLast = false;
+    else if (!isKeyDown(GLFW_KEY_RIGHT)) rightPressedLast = false;
 
     // ---    ---
     float moveStep = 0.1f;
     bool pointMoved = false;
-    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS) { controlPoints[selectedPoint].y += moveStep; pointMoved = true; }
-    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) { controlPoints[selectedPoint].y -= moveStep; pointMoved = true; }
-    if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) { controlPoints[selectedPoint].x -= moveStep; pointMoved = true; }
-    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) { controlPoints[selectedPoint].x += moveStep; pointMoved = true; }
-    if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS) { controlPoints[selectedPoint].z += moveStep; pointMoved = true; }
-    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) { controlPoints[selectedPoint].z -= moveStep; pointMoved = true; }
+    if (isKeyDown(GLFW_KEY_I)) { controlPoints[selectedPoint].y += moveStep; pointMoved = true; }
+    if (isKeyDown(GLFW_KEY_K)) { controlPoints[selectedPoint].y -= moveStep; pointMoved = true; }
+    if (isKeyDown(GLFW_KEY_J)) { controlPoints[selectedPoint].x -= moveStep; pointMoved = true; }
+    if (isKeyDown(GLFW_KEY_L)) { controlPoints[selectedPoint].x += moveStep; pointMoved = true; }
+    if (isKeyDown(GLFW_KEY_U)) { controlPoints[selectedPoint].z += moveStep; pointMoved = true; }
+    if (isKeyDown(GLFW_KEY_O)) { controlPoints[selectedPoint].z -= moveStep; pointMoved = true; }
 
     if (pointMoved) needsUpdate = true;
 
     // ---    ---
     static bool plusPressedLast = false, minusPressedLast = false;
-    if (glfwGetKey(window, GLFW_KEY_EQUAL) == GLFW_PRESS && !plusPressedLast) {
-        tessellation = std::min(tessellation + 1, 50);
+    if (isKeyDown(GLFW_KEY_EQUAL) && !plusPressedLast) {
+        tessellation = std::min(tessellation + 1, MAX_TESSELLATION);
         needsUpdate = true;
         plusPressedLast = true;
     }
-    else if (glfwGetKey(window, GLFW_KEY_EQUAL) == GLFW_RELEASE) plusPressedLast = false;
+    else if (!isKeyDown(GLFW_KEY_EQUAL)) plusPressedLast = false;
 
-    if (glfwGetKey(window, GLFW_KEY_MINUS) == GLFW_PRESS && !minusPressedLast) {
+    if (isKeyDown(GLFW_KEY_MINUS) && !minusPressedLast) {
         tessellation = std::max(tessellation - 1, 1);
         needsUpdate = true;
         minusPressedLast = true;
     }
-    else if (glfwGetKey(window, GLFW_KEY_MINUS) == GLFW_RELEASE) minusPressedLast = false;
-
-    // ---     ---
-    if (needsUpdate) {
-        //    
-        setupPointsBuffers();
+    else if (!isKeyDown(GLFW_KEY_MINUS)) minusPressedLast = false;
 
-        //  
-        generatePatch();
-        setupPatchBuffers();
+    // ---  :  /  ---
+    static bool tPressedLast = false;
+    if (isKeyDown(GLFW_KEY_T) && !tPressedLast) {
+        stripOutput = !stripOutput;
+        needsUpdate = true;
+        tPressedLast = true;
+
+        size_t listLength = 6 * tessellation * tessellation;
+        size_t stripLength = tessellation * (2 * tessellation + 3) - 1;
+        size_t used = stripOutput ? stripLength : listLength;
+        std::cout << "Patch output: " << (stripOutput ? "triangle strips" : "triangle list") << ", "
+            << used << " indices (" << used * sizeof(unsigned int) << " bytes, "
+            << 100 * used / listLength << "% of the triangle list)\n";
+    }
+    else if (!isKeyDown(GLFW_KEY_T)) tPressedLast = false;
 
-        needsUpdate = false;
+    // ---   : CPU    /   ---
+    static bool gPressedLast = false;
+    if (isKeyDown(GLFW_KEY_G) && !gPressedLast) {
+        gpuEvaluation = !gpuEvaluation;
+        needsUpdate = true;
+        gPressedLast = true;
+        std::cout << "Patch evaluation: " << (gpuEvaluation
+            ? "vertex shader (16 control points as uniforms, no vertex or index buffers)"
+            : "CPU tessellation into the streaming ring") << "\n";
     }
+    else if (!isKeyDown(GLFW_KEY_G)) gPressedLast = false;
 }
 
 // --- Resize  ---
@@ -393,49 +1344,228 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
 }
 
-// ---    ---
-GLuint createShaderProgram(const char* vertexPath, const char* fragmentPath) {
-    std::string vertexCode, fragmentCode;
-    std::ifstream vShaderFile(vertexPath), fShaderFile(fragmentPath);
+// --- FNV-1a:        ---
+uint64_t fnv1a(uint64_t hash, const char* text) {
+    for (const char* c = text; *c; c++)
+        hash = (hash ^ static_cast<unsigned char>(*c)) * 0x100000001B3ull;
+    return (hash ^ 0xFF) * 0x100000001B3ull; // ,  "ab"+"c"  "a"+"bc"  
+}
 
-    if (!vShaderFile.is_open() || !fShaderFile.is_open()) {
-        std::cout << "Failed to open shader files\n";
-        return 0;
+// ---    ---
+void initShaderCache() {
+    GLint formats = 0;
+    if (glfwExtensionSupported("GL_ARB_get_program_binary"))
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    shaderCache.getProgramBinary = (GetProgramBinaryProc)glfwGetProcAddress("glGetProgramBinary");
+    shaderCache.programBinary = (ProgramBinaryProc)glfwGetProcAddress("glProgramBinary");
+    shaderCache.programParameteri = (ProgramParameteriProc)glfwGetProcAddress("glProgramParameteri");
+    shaderCache.enabled = formats > 0 && shaderCache.getProgramBinary && shaderCache.programBinary && shaderCache.programParameteri;
+    if (!shaderCache.enabled) return;
+
+    uint64_t hash = FNV_OFFSET_BASIS;
+    hash = fnv1a(hash, (const char*)glGetString(GL_VENDOR));
+    hash = fnv1a(hash, (const char*)glGetString(GL_RENDERER));
+    hash = fnv1a(hash, (const char*)glGetString(GL_VERSION));
+    shaderCache.driverHash = hash;
+
+#ifdef _WIN32
+    _mkdir(SHADER_CACHE_DIR);
+#else
+    mkdir(SHADER_CACHE_DIR, 0755);
+#endif
+}
+
+std::string shaderCachePath(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return std::string(SHADER_CACHE_DIR) + "/" + name;
+}
+
+// ---   ; 0,   ,        ---
+GLuint loadCachedProgram(uint64_t key) {
+    FILE* file = fopen(shaderCachePath(key).c_str(), "rb");
+    if (!file) return 0;
+
+    ShaderCacheHeader header;
+    std::vector<char> binary;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == SHADER_CACHE_MAGIC && header.key == key && header.length > 0;
+    if (valid) {
+        binary.resize(header.length);
+        valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
     }
+    fclose(file);
+    if (!valid) return 0;
+
+    GLuint program = glCreateProgram();
+    shaderCache.programBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) { glDeleteProgram(program); return 0; }
+    return program;
+}
 
-    std::stringstream vShaderStream, fShaderStream;
-    vShaderStream << vShaderFile.rdbuf();
-    fShaderStream << fShaderFile.rdbuf();
-    vertexCode = vShaderStream.str();
-    fragmentCode = fShaderStream.str();
+void storeCachedProgram(GLuint program, uint64_t key) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum binaryFormat = 0;
+    shaderCache.getProgramBinary(program, length, &length, &binaryFormat, binary.data());
+
+    ShaderCacheHeader header = { SHADER_CACHE_MAGIC, binaryFormat, key, (uint32_t)length, 0 };
+    FILE* file = fopen(shaderCachePath(key).c_str(), "wb");
+    if (!file) return;
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(binary.data(), 1, length, file);
+    fclose(file);
+}
+
+// ---    ---
+bool readTextFile(const char* path, std::string& text) {
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+    std::stringstream stream;
+    stream << file.rdbuf();
+    text = stream.str();
+    return true;
+}
 
-    const char* vShaderCode = vertexCode.c_str();
-    const char* fShaderCode = fragmentCode.c_str();
+time_t fileModificationTime(const char* path) {
+    struct stat info;
+    return stat(path, &info) == 0 ? info.st_mtime : 0;
+}
+
+// ---  ; 0   ---
+GLuint compileShader(GLenum type, const char* source, const char* label) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
 
-    GLuint vertex, fragment;
     int success;
     char infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cout << label << " shader error: " << infoLog << "\n";
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
 
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-    if (!success) { glGetShaderInfoLog(vertex, 512, NULL, infoLog); std::cout << "Vertex shader error: " << infoLog << "\n"; }
+// ---    :  ,  ; 0   ---
+GLuint buildProgram(const std::string& vertexCode, const std::string& fragmentCode, uint64_t key) {
+    if (shaderCache.enabled) {
+        if (GLuint cached = loadCachedProgram(key)) return cached;
+    }
 
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-    if (!success) { glGetShaderInfoLog(fragment, 512, NULL, infoLog); std::cout << "Fragment shader error: " << infoLog << "\n"; }
+    GLuint vertex = compileShader(GL_VERTEX_SHADER, vertexCode.c_str(), "Vertex");
+    GLuint fragment = compileShader(GL_FRAGMENT_SHADER, fragmentCode.c_str(), "Fragment");
+    if (!vertex || !fragment) {
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        return 0;
+    }
 
     GLuint ID = glCreateProgram();
     glAttachShader(ID, vertex);
     glAttachShader(ID, fragment);
+    if (shaderCache.enabled) shaderCache.programParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(ID);
-    glGetProgramiv(ID, GL_LINK_STATUS, &success);
-    if (!success) { glGetProgramInfoLog(ID, 512, NULL, infoLog); std::cout << "Shader program error: " << infoLog << "\n"; }
-
     glDeleteShader(vertex);
     glDeleteShader(fragment);
+
+    int success;
+    char infoLog[512];
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(ID, 512, NULL, infoLog);
+        std::cout << "Shader program error: " << infoLog << "\n";
+        glDeleteProgram(ID);
+        return 0;
+    }
+
+    if (shaderCache.enabled) storeCachedProgram(ID, key);
     return ID;
-}
\ No newline at end of file
+}
+
+// ---     ---
+//      ;    
+bool loadShaderProgram(ShaderProgram& program) {
+    program.vertexTime = fileModificationTime(program.vertexPath);
+    program.fragmentTime = fileModificationTime(program.fragmentPath);
+
+    std::string vertexCode, fragmentCode;
+    if (!readTextFile(program.vertexPath, vertexCode) || !readTextFile(program.fragmentPath, fragmentCode)) {
+        std::cout << "Failed to open shader files\n";
+        return false;
+    }
+
+    uint64_t sourceHash = fnv1a(fnv1a(FNV_OFFSET_BASIS, vertexCode.c_str()), fragmentCode.c_str());
+    if (program.id && sourceHash == program.sourceHash) return true;
+
+    uint64_t key = fnv1a(fnv1a(shaderCache.driverHash, vertexCode.c_str()), fragmentCode.c_str());
+    GLuint id = buildProgram(vertexCode, fragmentCode, key);
+    if (!id) {
+        if (program.id) std::cout << "Shader reload failed, keeping the previous program\n";
+        return false;
+    }
+
+    if (program.id) {
+        glDeleteProgram(program.id);
+        std::cout << "Shaders reloaded\n";
+    }
+    program.id = id;
+    program.sourceHash = sourceHash;
+    return true;
+}
+
+// ---     ---
+// inotify  ,    :          rename
+void watchShaders() {
+#ifdef __linux__
+    shaderWatcher.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (shaderWatcher.fd >= 0 && inotify_add_watch(shaderWatcher.fd, SHADER_DIR, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        close(shaderWatcher.fd);
+        shaderWatcher.fd = -1;
+    }
+#endif
+}
+
+// ---    :  inotify,          ---
+//       :     
+void reloadChangedShaders(ShaderProgram** programs, size_t count) {
+#ifdef __linux__
+    if (shaderWatcher.fd >= 0) {
+        bool changed[MAX_WATCHED_PROGRAMS] = {};
+        alignas(inotify_event) char events[4096];
+        ssize_t length;
+        while ((length = read(shaderWatcher.fd, events, sizeof(events))) > 0) {
+            for (char* cursor = events; cursor < events + length; ) {
+                inotify_event* event = reinterpret_cast<inotify_event*>(cursor);
+                for (size_t i = 0; i < count && i < MAX_WATCHED_PROGRAMS; i++) {
+                    if (event->len > 0 && (strstr(programs[i]->vertexPath, event->name) || strstr(programs[i]->fragmentPath, event->name)))
+                        changed[i] = true;
+                }
+                cursor += sizeof(inotify_event) + event->len;
+            }
+        }
+        for (size_t i = 0; i < count && i < MAX_WATCHED_PROGRAMS; i++) {
+            if (changed[i]) loadShaderProgram(*programs[i]);
+        }
+        return;
+    }
+#endif
+    double now = glfwGetTime();
+    if (now - shaderWatcher.lastPoll < 1.0) return;
+    shaderWatcher.lastPoll = now;
+
+    for (size_t i = 0; i < count; i++) {
+        ShaderProgram& program = *programs[i];
+        bool changed = fileModificationTime(program.vertexPath) != program.vertexTime ||
+            fileModificationTime(program.fragmentPath) != program.fragmentTime;
+        if (changed) loadShaderProgram(program);
+    }
+}